@@ -0,0 +1,173 @@
+// Nixie clock board profiles.
+//
+// Copyright (c) 2020 Alexander Krotov.
+//
+// Each profile describes how a board is wired: the Raspberry Pi pins
+// (wiringPi numbering) driving the chips, the K155ID1 translate table,
+// the number of tubes and the bar, dot and led wiring. Everything is a
+// compile time constant, so the display code is folded to direct pin
+// writes. Select the profile when building:
+//
+//   cc -DBOARD=BOARD_IN14_4 clock.c ...
+//
+// Without BOARD the 6 tube IN-14 board is used, an unknown BOARD is an
+// error. boards_check.c checks the profiles against their expected wiring.
+
+#ifndef BOARDS_H
+#define BOARDS_H
+
+// Board profiles.
+#define BOARD_IN14      1  // IN-14 board.
+#define BOARD_IN14_4    2  // IN-14 board with only the hours and minutes tubes.
+#define BOARD_ALT_TEST  3  // Not a real board, see below.
+
+#ifndef BOARD
+#define BOARD BOARD_IN14
+#endif
+
+#if BOARD == BOARD_IN14 || BOARD == BOARD_IN14_4
+// IN-14 board, https://oshwlab.com/alexander.krotov/in14
+// Pin exits matching the electrical schematics, see the wiring table
+// in README.md. BOARD_IN14_4 is the same PCB with only the first four
+// tubes (hours and minutes) populated.
+
+// 74HC238 anode selector: A0, A1, A2 and E3 (enable).
+#define U2_1 14 // GPIO11
+#define U2_2 12 // GPIO10
+#define U2_3 13 // GPIO9
+#define U2_6 10 // GPIO8
+
+// K155ID1 U4 driving the dots: I1, I2.
+#define U4_3 11 // GPIO7
+#define U4_4 22 // GPIO6
+
+// K155ID1 U3 driving the digits: I1, I2, I4, I8.
+#define U3_3 21 // GPIO5
+#define U3_4 7  // GPIO4
+#define U3_6 9  // GPIO3
+#define U3_7 8  // GPIO2
+
+// K155ID1 U3 input code lighting each digit 0..9.
+#define DIGIT_CODE_0 3
+#define DIGIT_CODE_1 4
+#define DIGIT_CODE_2 5
+#define DIGIT_CODE_3 13
+#define DIGIT_CODE_4 12
+#define DIGIT_CODE_5 8
+#define DIGIT_CODE_6 9
+#define DIGIT_CODE_7 1
+#define DIGIT_CODE_8 0
+#define DIGIT_CODE_9 2
+
+// K155ID1 U3 input code with no digit wired, to light the dots alone.
+#define DIGIT_BLANK_CODE 6
+
+// Tubes are on 74HC238 outputs 1..NUM_TUBES.
+#if BOARD == BOARD_IN14_4
+#define NUM_TUBES 4
+#else
+#define NUM_TUBES 6
+#endif
+
+// 74HC238 outputs of the two IN-3 bars.
+#define BAR1_POS 0
+#define BAR2_POS 7
+
+// K155ID1 U4 input codes for the dots.
+#define DOT_RIGHT 0
+#define DOT_LEFT  3
+#define DOT_OFF   1
+
+// WS2812 backlight.
+#define LED_GPIO_PIN 18
+#define LED_COUNT    6
+
+#elif BOARD == BOARD_ALT_TEST
+// Not a real board. A different pin map, decoder outputs wired in digit
+// order and swapped bars, used to exercise the profile specialization
+// with boards_check.c and the simulator.
+#define U2_1 0  // GPIO17
+#define U2_2 2  // GPIO27
+#define U2_3 3  // GPIO22
+#define U2_6 4  // GPIO23
+
+#define U4_3 5  // GPIO24
+#define U4_4 6  // GPIO25
+
+#define U3_3 23 // GPIO13
+#define U3_4 24 // GPIO19
+#define U3_6 25 // GPIO26
+#define U3_7 27 // GPIO16
+
+#define DIGIT_CODE_0 0
+#define DIGIT_CODE_1 1
+#define DIGIT_CODE_2 2
+#define DIGIT_CODE_3 3
+#define DIGIT_CODE_4 4
+#define DIGIT_CODE_5 5
+#define DIGIT_CODE_6 6
+#define DIGIT_CODE_7 7
+#define DIGIT_CODE_8 8
+#define DIGIT_CODE_9 9
+
+#define DIGIT_BLANK_CODE 15
+
+#define NUM_TUBES 6
+
+#define BAR1_POS 7
+#define BAR2_POS 0
+
+#define DOT_RIGHT 1
+#define DOT_LEFT  2
+#define DOT_OFF   3
+
+#define LED_GPIO_PIN 18
+#define LED_COUNT    6
+#endif
+
+#ifndef NUM_TUBES
+#error "Unknown board profile"
+#endif
+
+// Translate table initializer, digit to K155ID1 input code.
+#define BOARD_TRANSLATE \
+	DIGIT_CODE_0, DIGIT_CODE_1, DIGIT_CODE_2, DIGIT_CODE_3, DIGIT_CODE_4, \
+	DIGIT_CODE_5, DIGIT_CODE_6, DIGIT_CODE_7, DIGIT_CODE_8, DIGIT_CODE_9
+
+// Sanity checks of the profile, done by the compiler.
+// A set of values is distinct when the sum of their bits equals the or.
+#define BOARD_BIT(n) (1ULL << (n))
+#define BOARD_SUM10(a, b, c, d, e, f, g, h, i, j) \
+	(BOARD_BIT(a) + BOARD_BIT(b) + BOARD_BIT(c) + BOARD_BIT(d) + BOARD_BIT(e) + \
+	 BOARD_BIT(f) + BOARD_BIT(g) + BOARD_BIT(h) + BOARD_BIT(i) + BOARD_BIT(j))
+#define BOARD_MASK10(a, b, c, d, e, f, g, h, i, j) \
+	(BOARD_BIT(a) | BOARD_BIT(b) | BOARD_BIT(c) | BOARD_BIT(d) | BOARD_BIT(e) | \
+	 BOARD_BIT(f) | BOARD_BIT(g) | BOARD_BIT(h) | BOARD_BIT(i) | BOARD_BIT(j))
+#define BOARD_SUM(...) BOARD_SUM10(__VA_ARGS__)
+#define BOARD_MASK(...) BOARD_MASK10(__VA_ARGS__)
+#define BOARD_DISTINCT(...) (BOARD_SUM(__VA_ARGS__) == BOARD_MASK(__VA_ARGS__))
+
+_Static_assert(BOARD_DISTINCT(BOARD_TRANSLATE),
+	       "digit codes must be distinct");
+_Static_assert(!(BOARD_BIT(DIGIT_BLANK_CODE) & BOARD_MASK(BOARD_TRANSLATE)) && DIGIT_BLANK_CODE < 16,
+	       "blank code must not light a digit");
+_Static_assert(DIGIT_CODE_0 < 16 && DIGIT_CODE_1 < 16 && DIGIT_CODE_2 < 16 &&
+	       DIGIT_CODE_3 < 16 && DIGIT_CODE_4 < 16 && DIGIT_CODE_5 < 16 &&
+	       DIGIT_CODE_6 < 16 && DIGIT_CODE_7 < 16 && DIGIT_CODE_8 < 16 &&
+	       DIGIT_CODE_9 < 16, "digit codes must fit the 4 decoder inputs");
+_Static_assert(BOARD_DISTINCT(U2_1, U2_2, U2_3, U2_6, U4_3, U4_4, U3_3, U3_4, U3_6, U3_7),
+	       "pins must be distinct");
+_Static_assert(U2_1 < 32 && U2_2 < 32 && U2_3 < 32 && U2_6 < 32 && U4_3 < 32 &&
+	       U4_4 < 32 && U3_3 < 32 && U3_4 < 32 && U3_6 < 32 && U3_7 < 32,
+	       "pins must be wiringPi pin numbers");
+_Static_assert(NUM_TUBES >= 4 && NUM_TUBES <= 6,
+	       "tubes 1..NUM_TUBES must fit the 74HC238 outputs between the bars");
+_Static_assert((BAR1_POS == 0 || BAR1_POS > NUM_TUBES) && BAR1_POS < 8 &&
+	       (BAR2_POS == 0 || BAR2_POS > NUM_TUBES) && BAR2_POS < 8 &&
+	       BAR1_POS != BAR2_POS, "bars must be on free 74HC238 outputs");
+_Static_assert(DOT_RIGHT < 4 && DOT_LEFT < 4 && DOT_OFF < 4 &&
+	       DOT_RIGHT != DOT_LEFT && DOT_OFF != DOT_RIGHT && DOT_OFF != DOT_LEFT,
+	       "dot codes must be distinct 2 bit codes");
+_Static_assert(LED_COUNT >= NUM_TUBES, "every tube needs a backlight led");
+
+#endif // BOARDS_H
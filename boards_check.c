@@ -0,0 +1,84 @@
+// Nixie clock board profile checks.
+//
+// Copyright (c) 2020 Alexander Krotov.
+//
+// Checks a board profile in boards.h against its expected wiring, written
+// out here independently of the profile: Raspberry Pi GPIO numbers from
+// the wiring table in README.md, K155ID1 codes from the schematics. The
+// file only compiles when the profile matches, check every profile with:
+//
+//   for b in BOARD_IN14 BOARD_IN14_4 BOARD_ALT_TEST; do
+//       cc -DBOARD=$b -fsyntax-only boards_check.c || break
+//   done
+
+#include "boards.h"
+
+// Raspberry Pi GPIO (BCM) number of a wiringPi pin.
+#define WPI_GPIO(n) \
+	((n) == 0 ? 17 : (n) == 1 ? 18 : (n) == 2 ? 27 : (n) == 3 ? 22 : \
+	 (n) == 4 ? 23 : (n) == 5 ? 24 : (n) == 6 ? 25 : (n) == 7 ? 4 : \
+	 (n) == 8 ? 2 : (n) == 9 ? 3 : (n) == 10 ? 8 : (n) == 11 ? 7 : \
+	 (n) == 12 ? 10 : (n) == 13 ? 9 : (n) == 14 ? 11 : (n) == 15 ? 14 : \
+	 (n) == 16 ? 15 : (n) == 21 ? 5 : (n) == 22 ? 6 : (n) == 23 ? 13 : \
+	 (n) == 24 ? 19 : (n) == 25 ? 26 : (n) == 26 ? 12 : (n) == 27 ? 16 : \
+	 (n) == 28 ? 20 : (n) == 29 ? 21 : (n) == 30 ? 0 : (n) == 31 ? 1 : -1)
+
+// Expected wiring: 74HC238 A0, A1, A2, E3, dots I1, I2, digits I1, I2,
+// I4, I8 GPIOs, digit codes 0..9, blank code, tubes, bars, dot codes and
+// the backlight.
+#if BOARD == BOARD_IN14 || BOARD == BOARD_IN14_4
+#define EXPECT_GPIOS  11, 10, 9, 8, 7, 6, 5, 4, 3, 2
+#define EXPECT_CODES  3, 4, 5, 13, 12, 8, 9, 1, 0, 2
+#define EXPECT_BLANK  6
+#if BOARD == BOARD_IN14_4
+#define EXPECT_TUBES  4
+#else
+#define EXPECT_TUBES  6
+#endif
+#define EXPECT_BARS   0, 7
+#define EXPECT_DOTS   0, 3, 1
+#define EXPECT_LEDS   18, 6
+#elif BOARD == BOARD_ALT_TEST
+#define EXPECT_GPIOS  17, 27, 22, 23, 24, 25, 13, 19, 26, 16
+#define EXPECT_CODES  0, 1, 2, 3, 4, 5, 6, 7, 8, 9
+#define EXPECT_BLANK  15
+#define EXPECT_TUBES  6
+#define EXPECT_BARS   7, 0
+#define EXPECT_DOTS   1, 2, 3
+#define EXPECT_LEDS   18, 6
+#else
+#error "No expected wiring for the board profile"
+#endif
+
+#define CHECK_GPIOS(a0, a1, a2, e3, d1, d2, i1, i2, i4, i8) \
+	(WPI_GPIO(U2_1) == (a0) && WPI_GPIO(U2_2) == (a1) && WPI_GPIO(U2_3) == (a2) && \
+	 WPI_GPIO(U2_6) == (e3) && WPI_GPIO(U4_3) == (d1) && WPI_GPIO(U4_4) == (d2) && \
+	 WPI_GPIO(U3_3) == (i1) && WPI_GPIO(U3_4) == (i2) && WPI_GPIO(U3_6) == (i4) && \
+	 WPI_GPIO(U3_7) == (i8))
+#define CHECK_CODES(c0, c1, c2, c3, c4, c5, c6, c7, c8, c9) \
+	(DIGIT_CODE_0 == (c0) && DIGIT_CODE_1 == (c1) && DIGIT_CODE_2 == (c2) && \
+	 DIGIT_CODE_3 == (c3) && DIGIT_CODE_4 == (c4) && DIGIT_CODE_5 == (c5) && \
+	 DIGIT_CODE_6 == (c6) && DIGIT_CODE_7 == (c7) && DIGIT_CODE_8 == (c8) && \
+	 DIGIT_CODE_9 == (c9))
+#define CHECK_BARS(b1, b2)  (BAR1_POS == (b1) && BAR2_POS == (b2))
+#define CHECK_DOTS(r, l, o) (DOT_RIGHT == (r) && DOT_LEFT == (l) && DOT_OFF == (o))
+#define CHECK_LEDS(g, n)    (LED_GPIO_PIN == (g) && LED_COUNT == (n))
+#define CHECK(f, ...) f(__VA_ARGS__)
+
+_Static_assert(CHECK(CHECK_GPIOS, EXPECT_GPIOS), "pin map does not match the wiring");
+_Static_assert(CHECK(CHECK_CODES, EXPECT_CODES), "translate table does not match the wiring");
+_Static_assert(DIGIT_BLANK_CODE == EXPECT_BLANK, "blank code does not match the wiring");
+_Static_assert(NUM_TUBES == EXPECT_TUBES, "number of tubes does not match the board");
+_Static_assert(CHECK(CHECK_BARS, EXPECT_BARS), "bars do not match the wiring");
+_Static_assert(CHECK(CHECK_DOTS, EXPECT_DOTS), "dot codes do not match the wiring");
+_Static_assert(CHECK(CHECK_LEDS, EXPECT_LEDS), "backlight does not match the wiring");
+
+// The backlight pin is a GPIO number, the chip pins are wiringPi numbers,
+// boards.h can't compare them.
+#define USES_GPIO(g) \
+	(WPI_GPIO(U2_1) == (g) || WPI_GPIO(U2_2) == (g) || WPI_GPIO(U2_3) == (g) || \
+	 WPI_GPIO(U2_6) == (g) || WPI_GPIO(U4_3) == (g) || WPI_GPIO(U4_4) == (g) || \
+	 WPI_GPIO(U3_3) == (g) || WPI_GPIO(U3_4) == (g) || WPI_GPIO(U3_6) == (g) || \
+	 WPI_GPIO(U3_7) == (g))
+
+_Static_assert(!USES_GPIO(LED_GPIO_PIN), "backlight pin is also driving a chip");
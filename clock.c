@@ -58,8 +58,12 @@
  * 
  */
 
+#ifdef SIMULATION
+#define _GNU_SOURCE
+#endif
 
 #include <stdint.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -74,7 +78,12 @@
 #include <getopt.h>
 #include <time.h>
 #include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
+#ifndef SIMULATION
 #include "clk.h"
 #include "gpio.h"
 #include "dma.h"
@@ -82,42 +91,48 @@
 #include "version.h"
 
 #include <wiringPi.h>
+#endif
 
 /* json-c (https://github.com/json-c/json-c) */
 #include <json-c/json.h>
 
 /* libcurl (http://curl.haxx.se/libcurl/c) */
 #include <curl/curl.h>
+#ifndef SIMULATION
 #include "ws2811.h"
+#endif
 
 #define STR(s) #s
 #define XSTR(s) STR(s)
 
+#include "boards.h"
+
 // defaults for led string options
 #define TARGET_FREQ             WS2811_TARGET_FREQ
-#define LED_GPIO_PIN            18
 #define DMA                     10
 #define STRIP_TYPE              WS2811_STRIP_GBR		// WS2812/SK6812RGB integrated chip+leds
-#define LED_COUNT               6
-
-/* Pin exits. Matching the electrical schematics. */
-#define U2_1 14 // GPIO11
-#define U2_2 12 // GPIO10
-#define U2_3 13 // GPIO9
-#define U2_6 10 // GPIO8
-
-#define U4_3 11 // GPIO7
-#define U4_4 22 // GPIO6
 
-#define U3_3 21 // GPIO5
-#define U3_4 7  // GPIO4
-#define U3_6 9  // GPIO3
-#define U3_7 8  // GPIO2
+// k155id1 output pin does not match to the digits we display,
+// so we need to use translation table to map digits to
+// the right output pin. The table is defined by the board profile.
+static const int translate[] = { BOARD_TRANSLATE };
+
+#ifdef SIMULATION
+// Simulated GPIO backend and virtual clock, see sim.h.
+#include "sim.h"
+#else
+// Wall clock time source.
+static void clock_now(struct timeval *tv)
+{
+	gettimeofday(tv, NULL);
+}
+#endif
 
 /* Thermometer readings for inside and outside temperature. */
 struct thermometers {
 	int inside;   // Inside temperature (read from ds18b20).
 	int outside;  // Outside temperature (read from openweathermap).
+	int stop;     // Reader stop request.
 	pthread_cond_t timer_cond;  // Reader stop message.
 	pthread_mutex_t timer_lock; // Thermometers lock.
 };
@@ -130,7 +145,9 @@ struct curl_fetch_st {
 
 int clear_on_exit = 0;
 
-static uint8_t running = 1;
+// Cleared by the signal handler, read by the display loop and the
+// control thread.
+static atomic_int running = 1;
 
 // Handle interrupt signal.
 static void ctrl_c_handler(int signum)
@@ -264,21 +281,21 @@ static void display_leds(ws2811_t *ledstring)
         }
 }
 
-// Show given digit on the indicator.
-static void show_digit(int d)
+// Set the k155id1 input code.
+static void show_code(int d)
 {
-	// k155id1 output pin does not match to the digits we display,
-	// so we need to use translation table to map digits to
-	// the right output pin.
-	static int translate[] = { 3, 4, 5, 13, 12, 8, 9, 1, 0, 2 };
-        d = translate[d];
-
 	digitalWrite(U3_3, d&1 ? HIGH: LOW);
 	digitalWrite(U3_4, d&2 ? HIGH: LOW);
 	digitalWrite(U3_6, d&4 ? HIGH: LOW);
 	digitalWrite(U3_7, d&8 ? HIGH: LOW);
 }
 
+// Show given digit on the indicator.
+static void show_digit(int d)
+{
+	show_code(translate[d]);
+}
+
 // Set dots on the indicator.
 static void show_dots(int d)
 {
@@ -315,7 +332,7 @@ static void run_all_digits()
         digitalWrite(U2_6, HIGH);
 	for (i=0; i<10; i++) {
             show_digit(i);
-	    for (j=1; j<=6; j++) {
+	    for (j=1; j<=NUM_TUBES; j++) {
 	        set_digit(j);
                 usleep(5000);
 	    }
@@ -330,93 +347,191 @@ static void display_time(struct tm *tm)
         display_pos(2, tm->tm_hour%10);
         display_pos(3, tm->tm_min/10);
         display_pos(4, tm->tm_min%10);
+#if NUM_TUBES >= 6
         display_pos(5, tm->tm_sec/10);
         display_pos(6, tm->tm_sec%10);
+#endif
 }
 
-// Light the bars
-static void display_bars(struct timeval *tv)
+// Animations are tables of keyframes, one per sub-second phase, so the
+// refresh loop only indexes the table by the current time.
+#define ANIM_PHASE_US     20000
+#define ANIM_PHASES       (1000000/ANIM_PHASE_US)
+#define ANIM_MAX_SECONDS  7
+
+// Running dots cycle and time each dot is lit.
+#define ANIM_DOTS_SECONDS 7
+#define ANIM_DOT_US       80000
+
+_Static_assert(ANIM_DOTS_SECONDS <= ANIM_MAX_SECONDS && ANIM_DOT_US % ANIM_PHASE_US == 0 &&
+	       2*NUM_TUBES*ANIM_DOT_US <= 1000000, "running dots must fit the animation");
+
+#define DOT_NONE 0xff
+
+// What to light during one phase.
+struct keyframe {
+	uint8_t outputs;  // Bitmask of 74HC238 outputs to light.
+	uint8_t dots;     // U4 dot code, DOT_NONE for bars and digits.
+	uint16_t on_us;   // Time to light each output.
+};
+
+// Keyframes lit from from_us to to_us within the given second of the cycle.
+struct anim_segment {
+	int sec;
+	int from_us;
+	int to_us;
+	struct keyframe kf;
+};
+
+struct animation {
+	int seconds;  // Length of the animation cycle.
+	struct keyframe frames[ANIM_MAX_SECONDS][ANIM_PHASES];
+};
+
+// Light the bars, first bar in the first half of the second and
+// the second bar in the second half.
+static const struct anim_segment bars_blink[] =
 {
-	if (tv->tv_usec < 500000) {
-	    set_digit(0);
-       	    digitalWrite(U2_6, HIGH);
-            usleep(3000);
-	} else {
-	    set_digit(7);
-            digitalWrite(U2_6, HIGH);
-            usleep(3000);
+	{ 0, 0, 500000, { 1<<BAR1_POS, DOT_NONE, 3000 } },
+	{ 0, 500000, 1000000, { 1<<BAR2_POS, DOT_NONE, 3000 } },
+};
+
+// Light both bars every other second.
+static const struct anim_segment bars_every_other_sec[] =
+{
+	{ 0, 0, 1000000, { 1<<BAR1_POS | 1<<BAR2_POS, DOT_NONE, 2000 } },
+};
+
+static struct animation bars_blink_anim;
+static struct animation bars_every_other_sec_anim;
+static struct animation dots_anim;
+
+// Add a segment to the animation keyframes, returns -1 if it does not
+// fit the animation.
+static int anim_add(struct animation *anim, const struct anim_segment *seg)
+{
+	int phase;
+
+	if (seg->sec < 0 || seg->sec >= anim->seconds ||
+	    seg->from_us < 0 || seg->from_us >= seg->to_us || seg->to_us > 1000000 ||
+	    seg->from_us % ANIM_PHASE_US != 0 || seg->to_us % ANIM_PHASE_US != 0) {
+	    fprintf(stderr, "Bad animation segment: second %d, %d..%d us\n",
+		    seg->sec, seg->from_us, seg->to_us);
+	    return -1;
+	}
+	for (phase = seg->from_us/ANIM_PHASE_US; phase < seg->to_us/ANIM_PHASE_US; phase++) {
+	    anim->frames[seg->sec][phase] = seg->kf;
 	}
-       	digitalWrite(U2_6, LOW);
+	return 0;
 }
 
-static void display_bars_every_other_sec(struct timeval *tv)
+static int anim_init(struct animation *anim, int seconds,
+		     const struct anim_segment *segs, int nsegs)
 {
-        if (tv->tv_sec % 2 == 0) {
-                set_digit(0);
-                digitalWrite(U2_6, HIGH);
-                usleep(2000);
+	int i;
+
+	memset(anim, 0, sizeof(*anim));
+	if (seconds < 1 || seconds > ANIM_MAX_SECONDS) {
+	    fprintf(stderr, "Bad animation length: %d seconds\n", seconds);
+	    return -1;
+	}
+	anim->seconds = seconds;
+	for (i = 0; i < nsegs; i++) {
+	    if (anim_add(anim, &segs[i]) != 0) {
+		return -1;
+	    }
+	}
+	return 0;
+}
 
-                set_digit(7);
-                digitalWrite(U2_6, HIGH);
-                usleep(2000);
+// Build the running dots. Every ANIM_DOTS_SECONDS we run the dots first
+// right to left and than next second left to right, one dot per ANIM_DOT_US.
+static int anim_init_dots(struct animation *anim)
+{
+	int d;
 
-                digitalWrite(U2_6, LOW);
+	if (anim_init(anim, ANIM_DOTS_SECONDS, NULL, 0) != 0) {
+	    return -1;
+	}
 
-                // Wait to let the power supply reset.
-                usleep(50);
-        }
-}
+	// We have total of 2 dots per tube.
+	for (d = 0; d < 2*NUM_TUBES; d++) {
+	    struct anim_segment seg = { 0, d*ANIM_DOT_US, (d+1)*ANIM_DOT_US, { 0, 0, 3000 } };
 
-// Display the running dots
-static void display_dots(struct timeval *tv)
-{
-	int light = 0; // Display a dot flag.
-
-	// Every 7 seconds we run the dots first right to left
-	// and than next second left to right.
-	if (tv->tv_sec % 7 == 0) {
-	    // Run the dosts right to left
-	    // First find the dot number.
-	    int d = tv->tv_usec/80000;
-	    // We have total of 12 dots.
-	    if (d<12) {
-		// Seth the indicator number.
-	        set_digit(6-d/2);
-	        if (d%2==0) {
-		    // Set the right dot
-                    show_dots(0);
-	        } else {
-		    // Set the left dot
-	            show_dots(3);
-	        }
-		light = 1;
+	    // Right to left.
+	    seg.kf.outputs = 1 << (NUM_TUBES-d/2);
+	    seg.kf.dots = d%2 == 0 ? DOT_RIGHT : DOT_LEFT;
+	    if (anim_add(anim, &seg) != 0) {
+		return -1;
 	    }
-	} else if (tv->tv_sec%7 == 1) {
-	    // Run the dosts left to right
-	    int d = tv->tv_usec/80000;
-	    if (d<12) {
-	        set_digit(d/2+1);
-	        if (d%2==0) {
-	            show_dots(3);
-	        } else {
-                    show_dots(0);
-	        }
-		light = 1;
+
+	    // Left to right.
+	    seg.sec = 1;
+	    seg.kf.outputs = 1 << (d/2+1);
+	    seg.kf.dots = d%2 == 0 ? DOT_LEFT : DOT_RIGHT;
+	    if (anim_add(anim, &seg) != 0) {
+		return -1;
 	    }
 	}
+	return 0;
+}
+
+// Build the animation tables, returns -1 if an animation is broken.
+static int init_animations(void)
+{
+	if (anim_init(&bars_blink_anim, 1, bars_blink,
+		      sizeof(bars_blink)/sizeof(bars_blink[0])) != 0 ||
+	    anim_init(&bars_every_other_sec_anim, 2, bars_every_other_sec,
+		      sizeof(bars_every_other_sec)/sizeof(bars_every_other_sec[0])) != 0 ||
+	    anim_init_dots(&dots_anim) != 0) {
+	    return -1;
+	}
+	return 0;
+}
 
-	if (light) {
-	    digitalWrite(U3_4, HIGH);
-	    digitalWrite(U3_6, HIGH);
-	    // Ligh the dot.
-            digitalWrite(U2_6, HIGH);
-            usleep(3000);
-            digitalWrite(U2_6, LOW);
+// Light the animation keyframe for the current time.
+static void display_animation(const struct animation *anim, struct timeval *tv)
+{
+	const struct keyframe *kf = &anim->frames[tv->tv_sec % anim->seconds][tv->tv_usec/ANIM_PHASE_US];
+	int pos;
+
+	if (kf->outputs == 0) {
+	    return;
+	}
+	if (kf->dots != DOT_NONE) {
+	    // Light the dot alone.
+	    show_dots(kf->dots);
+	    show_code(DIGIT_BLANK_CODE);
+	}
+	for (pos = 0; pos < 8; pos++) {
+	    if (kf->outputs & 1<<pos) {
+		set_digit(pos);
+		digitalWrite(U2_6, HIGH);
+		usleep(kf->on_us);
+	    }
+	}
+	digitalWrite(U2_6, LOW);
+	if (kf->dots != DOT_NONE) {
 	    // Reset the dot.
-	    show_dots(1);
+	    show_dots(DOT_OFF);
 	}
+
+	// Wait to let the power supply reset.
+	usleep(50);
+}
+
+#ifdef SIMULATION
+// Simulated thermometers, the timeline sets the readings, see sim.h.
+static void update_inside_temperature(struct thermometers *temp)
+{
+	temp->inside = sim.inside;
 }
 
+void update_outside_temperature(struct thermometers *temp)
+{
+	temp->outside = sim.outside;
+}
+#else
 // Read ds18b20 sensor and update inside temperature
 static void update_inside_temperature(struct thermometers *temp)
 {
@@ -521,6 +636,7 @@ void update_outside_temperature(struct thermometers *temp)
         /* free json object before return */
         json_object_put(json);
 }
+#endif
 
 // Read the thermometer data.
 // We use a dedicated thread to read the thermometers in order not
@@ -545,8 +661,11 @@ static void *thermometer_reader_thr(void *p)
 
 	    // Wait for the stop signal for 1 hour, and then update the 
 	    // readings again.
-	    rc = pthread_cond_timedwait(&temp->timer_cond, &temp->timer_lock, &cond_timer);
-	    if (rc == 0) {
+	    rc = 0;
+	    while (!temp->stop && rc == 0) {
+		rc = pthread_cond_timedwait(&temp->timer_cond, &temp->timer_lock, &cond_timer);
+	    }
+	    if (temp->stop) {
 		// Stop signal received.
                 break;
 	    }
@@ -557,6 +676,402 @@ static void *thermometer_reader_thr(void *p)
 	return NULL;
 }
 
+// Start reading the thermometers in dedicated thread. Returns -1 if the
+// thread can't be started.
+static int start_thermometers(struct thermometers *temp, pthread_t *thread_id)
+{
+	temp->inside = 0;
+	temp->outside = 0;
+	temp->stop = 0;
+	pthread_cond_init(&temp->timer_cond, NULL);
+	pthread_mutex_init(&temp->timer_lock, NULL);
+
+#ifdef SIMULATION
+	// Simulated readings are instant, have them before the first
+	// temperature frame.
+	update_inside_temperature(temp);
+	update_outside_temperature(temp);
+#endif
+
+	if (pthread_create(thread_id, NULL, thermometer_reader_thr, temp)) {
+	    fprintf(stderr, "Thermometer thread start failed.\n");
+	    return -1;
+	}
+	return 0;
+}
+
+// Stop the thermometer reader thread.
+static void stop_thermometers(struct thermometers *temp, pthread_t thread_id)
+{
+	// Send a stop signal to the thermometer reading thread.
+	pthread_mutex_lock(&temp->timer_lock);
+	temp->stop = 1;
+	pthread_cond_signal(&temp->timer_cond);
+	pthread_mutex_unlock(&temp->timer_lock);
+
+	// Wait for the thermometer reader thread to exit.
+	pthread_join(thread_id, NULL);
+}
+
+// Local control socket. Commands, one per line:
+//   digits <n>         show the given number instead of the time
+//   time               show the time
+//   poison             run all the digits once (anti cathode poisoning)
+//   dots on|off        running dots
+//   bars blink|steady  bars blinking twice a second or every other second
+//   temp on|off        temperature every 3 minutes
+//   stats              time frame timing since the last stats
+// The simulator serves no socket, it replays the commands from the
+// timeline, see sim.h.
+#ifndef CONTROL_SOCKET
+#define CONTROL_SOCKET "/run/nixie-clock.sock"
+#endif
+
+// Clients served at the same time, idle clients are dropped.
+#define CONTROL_MAX_CLIENTS 4
+#define CONTROL_IDLE_SEC    60
+
+// Command queue size, must be a power of 2.
+#define CMD_QUEUE_SIZE 64
+
+_Static_assert((CMD_QUEUE_SIZE & (CMD_QUEUE_SIZE-1)) == 0,
+	       "command queue size must be a power of 2");
+
+enum command_type {
+	CMD_DIGITS,
+	CMD_TIME,
+	CMD_POISON,
+	CMD_DOTS,
+	CMD_BARS,
+	CMD_TEMP,
+};
+
+struct command {
+	enum command_type type;
+	int arg;                    // On/off for dots, bars and temperature.
+	uint8_t digits[NUM_TUBES];  // Digits for CMD_DIGITS.
+};
+
+// Single producer single consumer queue from the control thread to the
+// display loop. Neither side ever blocks or takes a lock, so control
+// traffic can't delay the tubes.
+struct command_queue {
+	struct command cmds[CMD_QUEUE_SIZE];
+	atomic_uint head;  // Next slot to write, only moved by the control thread.
+	atomic_uint tail;  // Next slot to read, only moved by the display loop.
+};
+
+// Frame time histogram buckets.
+#define FRAME_BUCKET_US 500
+#define FRAME_BUCKETS   128
+
+// Timing of the frames showing the time, written by the display loop.
+// Running all the digits and the temperature frames are not counted,
+// they are much longer than the time frames by design. There is no sum
+// of the frame times, it would overflow 32 bits in about an hour and
+// 64 bit atomics are not lock free on every Pi. The average is taken
+// from the histogram instead.
+struct frame_stats {
+	atomic_ulong frames;
+	atomic_ulong max_us;
+	atomic_ulong buckets[FRAME_BUCKETS];  // The last bucket counts all longer frames.
+};
+
+static struct command_queue commands;
+static struct frame_stats frame_stats;
+
+// Add a command to the queue, returns -1 when the queue is full.
+static int command_push(struct command_queue *q, const struct command *cmd)
+{
+	unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (head - tail == CMD_QUEUE_SIZE) {
+	    return -1;
+	}
+	q->cmds[head & (CMD_QUEUE_SIZE-1)] = *cmd;
+	atomic_store_explicit(&q->head, head+1, memory_order_release);
+	return 0;
+}
+
+// Take the next command from the queue, returns 0 when the queue is empty.
+static int command_pop(struct command_queue *q, struct command *cmd)
+{
+	unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+	if (tail == head) {
+	    return 0;
+	}
+	*cmd = q->cmds[tail & (CMD_QUEUE_SIZE-1)];
+	atomic_store_explicit(&q->tail, tail+1, memory_order_release);
+	return 1;
+}
+
+// Parse a control command line, returns the reply to the client.
+static const char *control_command(char *line)
+{
+	static char reply[96];
+	struct command cmd;
+	char name[16], arg[16];
+	int n, i;
+
+	memset(&cmd, 0, sizeof(cmd));
+	n = sscanf(line, "%15s %15s", name, arg);
+	if (n <= 0) {
+	    return "error\n";
+	}
+
+	if (strcmp(name, "digits") == 0 && n == 2 && strlen(arg) == NUM_TUBES &&
+	    strspn(arg, "0123456789") == NUM_TUBES) {
+	    cmd.type = CMD_DIGITS;
+	    for (i = 0; i < NUM_TUBES; i++) {
+		cmd.digits[i] = arg[i] - '0';
+	    }
+	} else if (strcmp(name, "time") == 0 && n == 1) {
+	    cmd.type = CMD_TIME;
+	} else if (strcmp(name, "poison") == 0 && n == 1) {
+	    cmd.type = CMD_POISON;
+	} else if (strcmp(name, "dots") == 0 && n == 2 &&
+		   (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)) {
+	    cmd.type = CMD_DOTS;
+	    cmd.arg = strcmp(arg, "on") == 0;
+	} else if (strcmp(name, "bars") == 0 && n == 2 &&
+		   (strcmp(arg, "blink") == 0 || strcmp(arg, "steady") == 0)) {
+	    cmd.type = CMD_BARS;
+	    cmd.arg = strcmp(arg, "blink") == 0;
+	} else if (strcmp(name, "temp") == 0 && n == 2 &&
+		   (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)) {
+	    cmd.type = CMD_TEMP;
+	    cmd.arg = strcmp(arg, "on") == 0;
+	} else if (strcmp(name, "stats") == 0 && n == 1) {
+	    // Answered here, the display loop only updates the counters.
+	    unsigned long frames = atomic_exchange(&frame_stats.frames, 0);
+	    unsigned long max_us = atomic_exchange(&frame_stats.max_us, 0);
+	    unsigned long count = 0, p99_us = 0;
+	    double total_us = 0;
+
+	    // Average and 99th percentile from the histogram. The average
+	    // takes the middle of each bucket and the maximum for the last one,
+	    // the percentile is rounded up to the bucket.
+	    for (i = 0; i < FRAME_BUCKETS; i++) {
+		unsigned long n = atomic_exchange(&frame_stats.buckets[i], 0);
+
+		count += n;
+		total_us += (double)n * (i < FRAME_BUCKETS-1 ?
+					 (unsigned long)i*FRAME_BUCKET_US + FRAME_BUCKET_US/2 : max_us);
+		if (p99_us == 0 && count*100 >= frames*99 && count > 0) {
+		    p99_us = (i+1)*FRAME_BUCKET_US;
+		}
+	    }
+	    snprintf(reply, sizeof(reply), "frames %lu avg_us %lu p99_us %lu max_us %lu\n",
+		     frames, count ? (unsigned long)(total_us/count) : 0, p99_us, max_us);
+	    return reply;
+	} else {
+	    return "error\n";
+	}
+
+	if (command_push(&commands, &cmd) != 0) {
+	    return "busy\n";
+	}
+	return "ok\n";
+}
+
+#ifndef SIMULATION
+// Open the control socket. Returns -2 if another clock already serves
+// the socket and -1 on other failures.
+static int control_open(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, CONTROL_SOCKET, sizeof(addr.sun_path)-1);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+	    return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+	    // Don't take the socket away from a running clock.
+	    close(fd);
+	    return -2;
+	}
+	close(fd);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+	    return -1;
+	}
+	// Remove the socket left by a clock that is not running any more.
+	unlink(CONTROL_SOCKET);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0 ||
+	    fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+	    close(fd);
+	    return -1;
+	}
+	return fd;
+}
+#endif
+
+// Control socket client.
+struct control_client {
+	int fd;              // Client socket, -1 for a free slot.
+	char buf[128];       // Command line read so far.
+	size_t len;
+	time_t last;         // Time of the last command, for the idle timeout.
+};
+
+static void control_close(struct control_client *client)
+{
+	close(client->fd);
+	client->fd = -1;
+}
+
+// Serve the complete command lines read from the client. Returns -1 if
+// the client has to be dropped.
+static int control_serve(struct control_client *client)
+{
+	char *eol;
+
+	while ((eol = memchr(client->buf, '\n', client->len)) != NULL) {
+	    const char *reply;
+	    size_t n;
+
+	    *eol = 0;
+	    reply = control_command(client->buf);
+	    n = strlen(reply);
+
+	    // Replies are never waited for, a client not reading them is dropped.
+	    if (send(client->fd, reply, n, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)n) {
+		return -1;
+	    }
+	    client->len -= eol+1 - client->buf;
+	    memmove(client->buf, eol+1, client->len);
+	}
+	if (client->len == sizeof(client->buf)) {
+	    // Line too long.
+	    return -1;
+	}
+	return 0;
+}
+
+// Serve the control socket.
+// The commands are served by a dedicated thread, the display loop only
+// drains the command queue between frames. All the sockets are non
+// blocking and polled together, so no client can stall the others or
+// the shutdown.
+static void *control_thr(void *p)
+{
+	int listen_fd = *(int *)p;
+	struct control_client clients[CONTROL_MAX_CLIENTS];
+	struct pollfd pfds[CONTROL_MAX_CLIENTS+1];
+	int i;
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+	    clients[i].fd = -1;
+	}
+
+	while (running) {
+	    struct timespec now;
+	    int fd;
+
+	    pfds[0].fd = listen_fd;
+	    pfds[0].events = POLLIN;
+	    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		// Free slots have negative fd, ignored by poll.
+		pfds[i+1].fd = clients[i].fd;
+		pfds[i+1].events = POLLIN;
+		pfds[i+1].revents = 0;
+	    }
+
+	    // Wake up twice a second to check for the stop and idle clients.
+	    if (poll(pfds, CONTROL_MAX_CLIENTS+1, 500) < 0) {
+		continue;
+	    }
+	    clock_gettime(CLOCK_MONOTONIC, &now);
+
+	    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		struct control_client *client = &clients[i];
+		ssize_t rc;
+
+		if (client->fd < 0) {
+		    continue;
+		}
+		if (pfds[i+1].revents == 0) {
+		    if (now.tv_sec - client->last > CONTROL_IDLE_SEC) {
+			control_close(client);
+		    }
+		    continue;
+		}
+		rc = read(client->fd, client->buf+client->len, sizeof(client->buf)-client->len);
+		if (rc <= 0) {
+		    if (rc < 0 && (errno == EAGAIN || errno == EINTR)) {
+			continue;
+		    }
+		    control_close(client);
+		    continue;
+		}
+		client->len += rc;
+		client->last = now.tv_sec;
+		if (control_serve(client) != 0) {
+		    control_close(client);
+		}
+	    }
+
+	    if ((pfds[0].revents & POLLIN) && (fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		for (i = 0; i < CONTROL_MAX_CLIENTS && clients[i].fd >= 0; i++)
+		    ;
+		if (i == CONTROL_MAX_CLIENTS || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+		    send(fd, "busy\n", 5, MSG_DONTWAIT | MSG_NOSIGNAL);
+		    close(fd);
+		} else {
+		    clients[i].fd = fd;
+		    clients[i].len = 0;
+		    clients[i].last = now.tv_sec;
+		}
+	    }
+	}
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+	    if (clients[i].fd >= 0) {
+		control_close(&clients[i]);
+	    }
+	}
+	return NULL;
+}
+
+// Update the frame timing, called once per display loop iteration.
+static void update_frame_stats(struct timespec *last, int time_frame)
+{
+	struct timespec now;
+	unsigned long us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - last->tv_sec)*1000000 + (now.tv_nsec - last->tv_nsec)/1000;
+	*last = now;
+
+	if (!time_frame) {
+	    return;
+	}
+	atomic_fetch_add_explicit(&frame_stats.frames, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&frame_stats.buckets[us/FRAME_BUCKET_US < FRAME_BUCKETS ?
+						       us/FRAME_BUCKET_US : FRAME_BUCKETS-1],
+				  1, memory_order_relaxed);
+	if (us > atomic_load_explicit(&frame_stats.max_us, memory_order_relaxed)) {
+	    atomic_store_explicit(&frame_stats.max_us, us, memory_order_relaxed);
+	}
+}
+
+// Display the given digits.
+static void display_digits(const uint8_t *digits)
+{
+	int pos;
+
+	for (pos = 1; pos <= NUM_TUBES; pos++) {
+	    display_pos(pos, digits[pos-1]);
+	}
+}
+
 // Display the temperature (in Celcius degrees).
 static void display_thermometers(struct thermometers *temp, ws2811_t *ledstring)
 {
@@ -567,14 +1082,14 @@ static void display_thermometers(struct thermometers *temp, ws2811_t *ledstring)
         display_pos(1, temp->inside/10);
         display_pos(2, temp->inside%10);
 
-	// Indicators 5 and 6 show the outside temperature
+	// Last two indicators show the outside temperature
 	int outside = temp->outside;
 	if (outside < 0) {
 	    negative_outside = 1;
 	    outside = - outside;
 	}
-        display_pos(5, outside/10);
-        display_pos(6, outside%10);
+        display_pos(NUM_TUBES-1, outside/10);
+        display_pos(NUM_TUBES, outside%10);
 
         for (i = 0; i < LED_COUNT; i++) {
             ledstring->channel[0].leds[i] = 0;
@@ -591,15 +1106,23 @@ static void display_thermometers(struct thermometers *temp, ws2811_t *ledstring)
 	}
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     ws2811_return_t ret;
     int i;
     struct thermometers temp;
     pthread_t thread_id;
     int show_temp = 0;
+    int thermometers_started = 0;
     int show_running_dots = 0;
     int blinking_bars = 0;
+    int control_fd;
+    pthread_t control_thread_id;
+    struct command cmd;
+    int show_digits = 0;
+    uint8_t digits[NUM_TUBES];
+    int poison = 0;
+    struct timespec frame_start;
 
     ws2811_t ledstring =
     {
@@ -625,15 +1148,35 @@ int main()
         },
     };
 
-    if (show_temp) {
-        // Initialize thermometers.
-        temp.inside = 0;
-        temp.outside = 0;
-        pthread_cond_init(&temp.timer_cond, NULL);
-        pthread_mutex_init(&temp.timer_lock, NULL);
+#ifdef SIMULATION
+    if (sim_init(argc, argv) != 0) {
+        return 1;
     }
+#else
+    (void)(argc);
+    (void)(argv);
+#endif
+
     setup_handlers();
 
+    if (init_animations() != 0) {
+        return 1;
+    }
+
+#ifdef SIMULATION
+    // The timeline is the only producer of the command queue.
+    control_fd = -1;
+#else
+    // Open the control socket before touching the hardware, so a second
+    // clock refuses to start.
+    if ((control_fd = control_open()) == -2) {
+        fprintf(stderr, "Clock already running, control socket %s is in use.\n", CONTROL_SOCKET);
+        return 1;
+    } else if (control_fd < 0) {
+        fprintf(stderr, "Control socket %s open failed: %s\n", CONTROL_SOCKET, strerror(errno));
+    }
+#endif
+
     // Initialize led backligh
     if ((ret = ws2811_init(&ledstring)) != WS2811_SUCCESS) {
         fprintf(stderr, "ws2811_init failed: %s\n", ws2811_get_return_t_str(ret));
@@ -664,22 +1207,62 @@ int main()
 
     if (show_temp) {
         // Read the thermometers in dedicated thread.
-        if (pthread_create(&thread_id, NULL, thermometer_reader_thr, &temp)) {
-                fprintf(stderr, "Thermometer thread start failed.\n");
-        }
+        thermometers_started = start_thermometers(&temp, &thread_id) == 0;
+        show_temp = thermometers_started;
+    }
+
+    // Serve the control socket in dedicated thread.
+    if (control_fd >= 0 && pthread_create(&control_thread_id, NULL, control_thr, &control_fd)) {
+        fprintf(stderr, "Control thread start failed.\n");
+        close(control_fd);
+        control_fd = -1;
     }
+
+    clock_gettime(CLOCK_MONOTONIC, &frame_start);
     for (i=0; running; i++) {
 	struct tm *tm;
 	struct timeval tv;
 	int update_leds = 0;
+	int time_frame = 0;
+
+	// Apply the control commands between frames.
+	while (command_pop(&commands, &cmd)) {
+	    switch (cmd.type) {
+	    case CMD_DIGITS:
+		memcpy(digits, cmd.digits, sizeof(digits));
+		show_digits = 1;
+		break;
+	    case CMD_TIME:
+		show_digits = 0;
+		break;
+	    case CMD_POISON:
+		poison = 1;
+		break;
+	    case CMD_DOTS:
+		show_running_dots = cmd.arg;
+		break;
+	    case CMD_BARS:
+		blinking_bars = cmd.arg;
+		break;
+	    case CMD_TEMP:
+		// The thermometers are started on first use and kept
+		// running until exit.
+		if (cmd.arg && !thermometers_started) {
+		    thermometers_started = start_thermometers(&temp, &thread_id) == 0;
+		}
+		show_temp = cmd.arg && thermometers_started;
+		break;
+	    }
+	}
 
 	// Read the current time
-	gettimeofday(&tv, NULL);
+	clock_now(&tv);
 	tm = localtime(&tv.tv_sec);
 
-	if (tm->tm_min%5 == 1 && tm->tm_sec==tm->tm_min) {
+	if (poison || (tm->tm_min%5 == 1 && tm->tm_sec==tm->tm_min)) {
 	    // Every 5 minutes run all the digits on all indicators for 1 second.
             run_all_digits();
+	    poison = 0;
 	} else if (show_temp && tm->tm_min%3==1 && tm->tm_sec>tm->tm_min && tm->tm_sec<=tm->tm_min+3 &&
 	           pthread_mutex_trylock(&temp.timer_lock) == 0)
 	{
@@ -691,19 +1274,24 @@ int main()
 	    pthread_mutex_unlock(&temp.timer_lock);
         } else {
 	    // By default show current time.
-            display_time(tm);
+	    time_frame = 1;
+	    if (show_digits) {
+		display_digits(digits);
+	    } else {
+		display_time(tm);
+	    }
 
             if (blinking_bars) {
                 if (i%3 == 0) {
                         // We light the bars once per 3 iterations
                         // to dime them a bit.
-                        display_bars(&tv);
+                        display_animation(&bars_blink_anim, &tv);
                 }
             } else {
-                display_bars_every_other_sec(&tv);
+                display_animation(&bars_every_other_sec_anim, &tv);
             }
             if (show_running_dots) {
-	        display_dots(&tv);
+	        display_animation(&dots_anim, &tv);
             }
 
             if (i%4==0) {
@@ -719,13 +1307,19 @@ int main()
                 fprintf(stderr, "ws2811_render failed: %s\n", ws2811_get_return_t_str(ret));
 	    }
         }
+
+	update_frame_stats(&frame_start, time_frame);
     }
 
-    if (show_temp) {
-        // Send a stop signal to the thermometer reading thread 
-        pthread_cond_signal(&temp.timer_cond);
-        // Wait for the thermometer reader thread to exit.
-        pthread_join(thread_id, NULL);
+    if (control_fd >= 0) {
+        // The control thread checks running and exits.
+        pthread_join(control_thread_id, NULL);
+        close(control_fd);
+        unlink(CONTROL_SOCKET);
+    }
+
+    if (thermometers_started) {
+        stop_thermometers(&temp, thread_id);
     }
     if (clear_on_exit) {
 	matrix_clear(&ledstring);
@@ -734,5 +1328,11 @@ int main()
 
     ws2811_fini(&ledstring);
 
+#ifdef SIMULATION
+    if (sim_status() != 0) {
+        return 1;
+    }
+#endif
+
     return ret;
 }
@@ -0,0 +1,136 @@
+// Nixie clock control client.
+//
+// Copyright (c) 2020 Alexander Krotov.
+//
+// Sends a command to the clock control socket and prints the reply:
+//
+//   cc clockctl.c -o clockctl
+//   ./clockctl digits 123456
+//   ./clockctl time
+//
+// -s selects another socket, e.g. of a clock built with another CONTROL_SOCKET.
+// With -n the command is sent the given number of times as fast as
+// possible, to load test the control path. The time frame stats are
+// reset before the load and read after it, and read again after the
+// same time without load, so the two can be compared.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef CONTROL_SOCKET
+#define CONTROL_SOCKET "/run/nixie-clock.sock"
+#endif
+
+// Connection to the clock.
+struct ctl {
+	int fd;
+	FILE *in;
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: clockctl [-s socket] [-n count] command [arg]\n");
+	exit(2);
+}
+
+static void ctl_open(struct ctl *ctl, const char *path)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+
+	if ((ctl->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    connect(ctl->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+	    perror(path);
+	    exit(1);
+	}
+	ctl->in = fdopen(ctl->fd, "r");
+}
+
+// Send a command line and read the reply.
+static void ctl_command(struct ctl *ctl, const char *line, char *reply, size_t size)
+{
+	if (write(ctl->fd, line, strlen(line)) < 0 || fgets(reply, size, ctl->in) == NULL) {
+	    perror("clockctl");
+	    exit(1);
+	}
+}
+
+static double elapsed(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ctl ctl;
+	struct timespec start;
+	char line[128], reply[128], load_stats[128];
+	const char *path = CONTROL_SOCKET;
+	long count = 1, i, busy = 0;
+	double secs;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:n:")) != -1) {
+	    if (c == 's') {
+		path = optarg;
+	    } else if (c == 'n') {
+		count = atol(optarg);
+	    } else {
+		usage();
+	    }
+	}
+	if (optind >= argc || count < 1) {
+	    usage();
+	}
+
+	snprintf(line, sizeof(line), "%s%s%s\n", argv[optind],
+		 optind+1 < argc ? " " : "", optind+1 < argc ? argv[optind+1] : "");
+
+	ctl_open(&ctl, path);
+
+	if (count == 1) {
+	    ctl_command(&ctl, line, reply, sizeof(reply));
+	    fputs(reply, stdout);
+	    fclose(ctl.in);
+	    return 0;
+	}
+
+	// Reset the stats, then load.
+	ctl_command(&ctl, "stats\n", reply, sizeof(reply));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++) {
+	    ctl_command(&ctl, line, reply, sizeof(reply));
+	    if (strcmp(reply, "busy\n") == 0) {
+		busy++;
+	    }
+	}
+	secs = elapsed(&start);
+	ctl_command(&ctl, "stats\n", load_stats, sizeof(load_stats));
+	fclose(ctl.in);
+
+	printf("%ld commands in %.3f seconds, %.0f/s, %ld accepted, %ld busy\n",
+	       count, secs, count / secs, count - busy, busy);
+	printf("under load: %s", load_stats);
+
+	// Same time without load, on a new connection to stay clear of the
+	// idle timeout.
+	usleep(secs * 1000000);
+	ctl_open(&ctl, path);
+	ctl_command(&ctl, "stats\n", reply, sizeof(reply));
+	fclose(ctl.in);
+	printf("idle:       %s", reply);
+
+	return 0;
+}
@@ -0,0 +1,657 @@
+// Nixie clock simulation backend.
+//
+// Copyright (c) 2020 Alexander Krotov.
+//
+// Replaces wiringPi and libws2811 with a simulated GPIO backend driven by
+// a virtual clock, so the display schedule can be replayed faster than
+// real time on any Linux box:
+//
+//   cc -DSIMULATION clock.c -lcurl -ljson-c -lpthread -o clock-sim
+//   ./clock-sim [-c] timeline.txt
+//
+// The virtual clock only moves forward when the clock program sleeps, so
+// the refresh loop runs exactly the same code as on the real hardware.
+// Every virtual second one trace line is printed to stdout with the local
+// time the clock should show and what was actually lit on the tubes, the
+// bars around them and the dots in the order they were lit:
+//
+//   2026-10-24 17:00:02 EEST  |170002|  dots 6r6l5r5l4r4l3r3l2r2l1r1l
+//
+// A bar is '|' when lit in both halves of the second, '<' or '>' in the
+// first or the second half only. With -c the tubes are checked against
+// the local time, each mismatch is reported to stderr and the program
+// exits with 1. All the digits must run ('*' in the trace) exactly in
+// the seconds the clock schedules it: the startup sweep and the anti
+// cathode poisoning. The bar phase and the running dots are checked too,
+// except in the seconds a mode or a step takes effect.
+//
+// Timeline file format, one command per line, '#' starts a comment.
+// At most SIM_MAX_STEPS steps and SIM_MAX_MODES modes, each listed in
+// time order:
+//
+//   tz <TZ>                          time zone, e.g. EET-2EEST,M3.5.0/3,M10.5.0/4
+//   start <YYYY-mm-dd HH:MM:SS>      virtual clock start (UTC)
+//   end <YYYY-mm-dd HH:MM:SS>        virtual clock end (UTC)
+//   step <YYYY-mm-dd HH:MM:SS> <sec> step the clock by <sec> seconds (NTP step)
+//   mode <YYYY-mm-dd HH:MM:SS> <cmd> send a control command to the clock:
+//                                    digits <n>, time, dots on|off,
+//                                    bars blink|steady or temp on|off
+//   thermometers <inside> <outside>  simulated readings, 21 and -5 by default
+//
+// The mode commands go through the command queue like the commands of
+// the control socket, which the simulator does not serve. The checker
+// follows them: custom digits and the temperature are expected too.
+//
+// This file is included by clock.c after the board profile, see boards.h.
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <errno.h>
+#include <inttypes.h>
+
+// wiringPi replacement.
+#define HIGH   1
+#define LOW    0
+#define OUTPUT 1
+
+// libws2811 replacement, only what clock.c uses.
+#define WS2811_TARGET_FREQ 800000
+#define WS2811_STRIP_GBR   0x00100008
+#define RPI_PWM_CHANNELS   2
+
+typedef uint32_t ws2811_led_t;
+
+typedef enum {
+	WS2811_SUCCESS = 0,
+	WS2811_ERROR_OUT_OF_MEMORY = -2,
+} ws2811_return_t;
+
+typedef struct {
+	int gpionum;
+	int invert;
+	int count;
+	int strip_type;
+	ws2811_led_t *leds;
+	uint8_t brightness;
+} ws2811_channel_t;
+
+typedef struct {
+	uint32_t freq;
+	int dmanum;
+	ws2811_channel_t channel[RPI_PWM_CHANNELS];
+} ws2811_t;
+
+#define SIM_MAX_PINS  32
+#define SIM_MAX_STEPS 64
+#define SIM_MAX_MODES 64
+
+// Outputs lit for less than this during a second are frame spill.
+#define SIM_MIN_US 10000
+
+// Running dots cycle of clock.c.
+#define SIM_DOTS_SECONDS 7
+
+// NTP step in the timeline.
+struct sim_step {
+	int64_t at_us;  // Virtual time of the step.
+	int64_t delta;  // Step size in seconds.
+};
+
+// Control command in the timeline.
+struct sim_mode {
+	int64_t at_us;  // Virtual time of the command.
+	char cmd[32];   // Command line, as sent to the control socket.
+};
+
+// What the clock is told to show by the mode commands.
+struct sim_display {
+	int show_digits;
+	char digits[NUM_TUBES+1];
+	int show_temp;
+	int running_dots;
+	int blinking_bars;
+};
+
+// Control command parser of clock.c, the mode commands are sent through it.
+static const char *control_command(char *line);
+
+// Simulated hardware and virtual clock state.
+static struct {
+	int pins[SIM_MAX_PINS];        // Output pin levels.
+	int64_t now_us;                // Virtual time in microseconds.
+	int64_t start_us;              // Start of the timeline.
+	int64_t end_us;                // End of the timeline.
+	struct sim_step steps[SIM_MAX_STEPS];
+	int nsteps;
+	int next_step;
+	struct sim_mode modes[SIM_MAX_MODES];
+	int nmodes;
+	int next_mode;
+	struct sim_display display;    // Modes sent to the clock so far.
+	int inside;                    // Simulated thermometer readings.
+	int outside;
+	int finished;
+	int check;                     // Check the tubes show the time.
+	unsigned long mismatches;      // Seconds the tubes did not show the time.
+	int looping;                   // Display loop started, startup sweep done.
+	int all_digits;                // All the digits run in the last second.
+
+	// What was lit during the current virtual second.
+	time_t second;
+	int64_t lit_us[8][16];         // Lit time per 74HC238 output and decoder code.
+	int64_t bar_us[2][2];          // Lit time per bar and half of the second.
+	char dots[64];                 // Dots lit in order, e.g. 6r6l5r.
+	int ndots;
+	int changed;                   // A mode or a step was applied.
+
+	unsigned long lines;           // Trace lines printed.
+	struct timespec wall_start;
+} sim;
+
+static int sim_read_bits(int b0, int b1, int b2, int b3)
+{
+	return sim.pins[b0] | sim.pins[b1] << 1 | sim.pins[b2] << 2 | sim.pins[b3] << 3;
+}
+
+// Bar state during the second: ' ' dark, '<' lit in the first half only,
+// '>' in the second half only, '|' in both.
+static char sim_bar(int bar)
+{
+	int first = sim.bar_us[bar][0] >= SIM_MIN_US;
+	int second = sim.bar_us[bar][1] >= SIM_MIN_US;
+
+	return first && second ? '|' : first ? '<' : second ? '>' : ' ';
+}
+
+// Running dots expected during the second, written like the trace. Every
+// SIM_DOTS_SECONDS the dots run right to left, the right dot of each tube
+// first, and the next second left to right.
+static void sim_expected_dots(char *dots)
+{
+	int sec = sim.second % SIM_DOTS_SECONDS;
+	int d;
+
+	dots[0] = 0;
+	if (sec > 1) {
+	    return;
+	}
+	for (d = 0; d < 2*NUM_TUBES; d++) {
+	    dots[2*d] = '0' + (sec == 0 ? NUM_TUBES - d/2 : d/2 + 1);
+	    dots[2*d+1] = (d%2 == 0) == (sec == 0) ? 'r' : 'l';
+	}
+	dots[4*NUM_TUBES] = 0;
+}
+
+// Check the second against the schedule of clock.c and the modes.
+static void sim_check_second(struct tm *tm, const char *when, const char *tubes,
+			     const char *bars, const char *dots)
+{
+	char expected[8], expected_bars[3], expected_dots[4*NUM_TUBES+1];
+	int all_digits = !sim.looping || (tm->tm_min%5 == 1 && tm->tm_sec == tm->tm_min);
+	int temp = sim.display.show_temp && tm->tm_min%3 == 1 &&
+		   tm->tm_sec > tm->tm_min && tm->tm_sec <= tm->tm_min+3;
+	int pos;
+
+	// No bars and dots with all the digits and the temperature.
+	strcpy(expected_bars, "  ");
+	expected_dots[0] = 0;
+
+	if (all_digits) {
+	    // Startup sweep or the anti poisoning schedule.
+	    memset(expected, '*', NUM_TUBES);
+	} else if (temp) {
+	    // Inside on the first two tubes and outside on the last two.
+	    memset(expected, '-', NUM_TUBES);
+	    expected[0] = '0' + sim.inside/10;
+	    expected[1] = '0' + sim.inside%10;
+	    expected[NUM_TUBES-2] = '0' + abs(sim.outside)/10;
+	    expected[NUM_TUBES-1] = '0' + abs(sim.outside)%10;
+
+	    // The last run of all the digits spills into the next second,
+	    // the tubes dark in it show the run.
+	    for (pos = 0; sim.all_digits && pos < NUM_TUBES; pos++) {
+		if (expected[pos] == '-' && tubes[pos] == '*') {
+		    expected[pos] = '*';
+		}
+	    }
+	} else {
+	    if (sim.display.show_digits) {
+		memcpy(expected, sim.display.digits, NUM_TUBES);
+	    } else {
+		strftime(expected, sizeof(expected), "%H%M%S", tm);
+	    }
+	    if (sim.display.blinking_bars) {
+		// First bar in the first half, second bar in the second half.
+		strcpy(expected_bars, "<>");
+	    } else if (sim.second % 2 == 0) {
+		strcpy(expected_bars, "||");
+	    }
+	    if (sim.display.running_dots) {
+		sim_expected_dots(expected_dots);
+	    }
+	}
+	expected[NUM_TUBES] = 0;
+
+	if (strcmp(tubes, expected) != 0) {
+	    fprintf(stderr, "%s: tubes show %s, expected %s\n", when, tubes, expected);
+	    sim.mismatches++;
+	}
+
+	// Modes and steps take effect at the next frame and the last run of
+	// all the digits delays the frames of the next second, the bars and
+	// dots of these seconds are not checked.
+	if (!sim.changed && !sim.all_digits) {
+	    if (strcmp(bars, expected_bars) != 0) {
+		fprintf(stderr, "%s: bars show '%s', expected '%s'\n", when, bars, expected_bars);
+		sim.mismatches++;
+	    }
+	    if (strcmp(dots, expected_dots) != 0) {
+		fprintf(stderr, "%s: dots show '%s', expected '%s'\n", when, dots, expected_dots);
+		sim.mismatches++;
+	    }
+	}
+	sim.all_digits = all_digits;
+}
+
+// Print what was lit during the last virtual second.
+static void sim_flush_second(void)
+{
+	struct tm tm;
+	char when[64];
+	char tubes[NUM_TUBES+1];
+	char bars[3];
+	int pos, d;
+
+	localtime_r(&sim.second, &tm);
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S %Z", &tm);
+
+	for (pos = 1; pos <= NUM_TUBES; pos++) {
+	    int64_t total = 0, best = 0;
+	    char c = '-';
+
+	    // Show the digit lit for the longest time. The frame crossing
+	    // the second boundary spills a bit of the previous digit, the
+	    // last run of all the digits up to a third of a second.
+	    for (d = 0; d < 10; d++) {
+		int64_t us = sim.lit_us[pos][translate[d]];
+
+		total += us;
+		if (us > best) {
+		    best = us;
+		    c = '0' + d;
+		}
+	    }
+	    if (total < SIM_MIN_US) {
+		c = '-';
+	    } else if (best*2 < total) {
+		// No digit dominates, all the digits run.
+		c = '*';
+	    }
+	    tubes[pos-1] = c;
+	}
+	tubes[NUM_TUBES] = 0;
+	bars[0] = sim_bar(0);
+	bars[1] = sim_bar(1);
+	bars[2] = 0;
+
+	if (sim.check) {
+	    sim_check_second(&tm, when, tubes, bars, sim.dots);
+	}
+
+	printf("%s  %c%s%c  dots %s\n", when, bars[0], tubes, bars[1],
+	       sim.ndots > 0 ? sim.dots : "-");
+	sim.lines++;
+
+	memset(sim.lit_us, 0, sizeof(sim.lit_us));
+	memset(sim.bar_us, 0, sizeof(sim.bar_us));
+	sim.dots[0] = 0;
+	sim.ndots = 0;
+	sim.changed = 0;
+}
+
+// Record a lit dot, written as the tube and the side. A dot lit over
+// several frames is recorded once.
+static void sim_add_dot(int pos, char side)
+{
+	if (sim.ndots >= 2 && sim.dots[sim.ndots-2] == '0'+pos && sim.dots[sim.ndots-1] == side) {
+	    return;
+	}
+	if (sim.ndots+2 < (int)sizeof(sim.dots)) {
+	    sim.dots[sim.ndots++] = '0'+pos;
+	    sim.dots[sim.ndots++] = side;
+	    sim.dots[sim.ndots] = 0;
+	}
+}
+
+// Record the tube state lit for the given time.
+static void sim_sample(int64_t us)
+{
+	int pos, code, d, dot;
+
+	if (!sim.pins[U2_6]) {
+	    return;
+	}
+	pos = sim.pins[U2_1] | sim.pins[U2_2] << 1 | sim.pins[U2_3] << 2;
+	code = sim_read_bits(U3_3, U3_4, U3_6, U3_7);
+
+	if (pos >= 1 && pos <= NUM_TUBES) {
+	    for (d = 0; d < 10; d++) {
+		if (translate[d] == code) {
+		    sim.lit_us[pos][code] += us;
+		    return;
+		}
+	    }
+	    // Decoder is blanked, only the dot is lit.
+	    dot = sim.pins[U4_3] | sim.pins[U4_4] << 1;
+	    sim_add_dot(pos, dot == DOT_RIGHT ? 'r' : dot == DOT_LEFT ? 'l' : '?');
+	} else if (pos == BAR1_POS || pos == BAR2_POS) {
+	    sim.bar_us[pos == BAR1_POS ? 0 : 1][sim.now_us % 1000000 >= 500000] += us;
+	}
+}
+
+// Update the display modes with a mode command. Returns -1 for a command
+// the checker can't follow.
+static int sim_set_mode(struct sim_display *display, const char *cmd)
+{
+	char name[16], arg[16];
+	int n = sscanf(cmd, "%15s %15s", name, arg);
+
+	if (n == 2 && strcmp(name, "digits") == 0 && strlen(arg) == NUM_TUBES &&
+	    strspn(arg, "0123456789") == NUM_TUBES) {
+	    display->show_digits = 1;
+	    strcpy(display->digits, arg);
+	} else if (n == 1 && strcmp(name, "time") == 0) {
+	    display->show_digits = 0;
+	} else if (n == 2 && strcmp(name, "temp") == 0 &&
+		   (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)) {
+	    display->show_temp = strcmp(arg, "on") == 0;
+	} else if (n == 2 && strcmp(name, "dots") == 0 &&
+		   (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)) {
+	    display->running_dots = strcmp(arg, "on") == 0;
+	} else if (n == 2 && strcmp(name, "bars") == 0 &&
+		   (strcmp(arg, "blink") == 0 || strcmp(arg, "steady") == 0)) {
+	    display->blinking_bars = strcmp(arg, "blink") == 0;
+	} else {
+	    return -1;
+	}
+	return 0;
+}
+
+// Send a mode command to the clock. The display loop applies it before
+// the next frame.
+static void sim_send_mode(const struct sim_mode *mode)
+{
+	char line[sizeof(mode->cmd)];
+	const char *reply;
+
+	strcpy(line, mode->cmd);
+	reply = control_command(line);
+	if (strcmp(reply, "ok\n") != 0) {
+	    fprintf(stderr, "mode %s: %s", mode->cmd, reply);
+	    sim.mismatches++;
+	}
+	sim_set_mode(&sim.display, mode->cmd);
+	sim.changed = 1;
+}
+
+// Advance the virtual clock, applying the timeline steps and modes.
+static void sim_advance(int64_t us)
+{
+	struct timespec wall_end;
+	double wall;
+	int stepped = 0;
+
+	sim.now_us += us;
+	while (sim.next_step < sim.nsteps && sim.steps[sim.next_step].at_us <= sim.now_us) {
+	    sim.now_us += sim.steps[sim.next_step].delta * 1000000;
+	    sim.next_step++;
+	    stepped = 1;
+	}
+
+	if (sim.now_us / 1000000 != sim.second) {
+	    sim_flush_second();
+	    sim.second = sim.now_us / 1000000;
+	}
+	if (stepped) {
+	    sim.changed = 1;
+	}
+
+	while (sim.next_mode < sim.nmodes && sim.modes[sim.next_mode].at_us <= sim.now_us) {
+	    sim_send_mode(&sim.modes[sim.next_mode]);
+	    sim.next_mode++;
+	}
+
+	if (sim.now_us >= sim.end_us && !sim.finished) {
+	    sim.finished = 1;
+
+	    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	    wall = (wall_end.tv_sec - sim.wall_start.tv_sec) +
+		   (wall_end.tv_nsec - sim.wall_start.tv_nsec) / 1e9;
+	    fprintf(stderr, "Simulated %.0f seconds in %.3f seconds, %lu trace lines.\n",
+		    (sim.end_us - sim.start_us) / 1e6, wall, sim.lines);
+	    if (sim.check) {
+		fprintf(stderr, "%lu mismatches.\n", sim.mismatches);
+	    }
+
+	    // Stop the main loop the same way as on SIGTERM.
+	    raise(SIGTERM);
+	}
+}
+
+static int sim_usleep(useconds_t us)
+{
+	sim_sample(us);
+	sim_advance(us);
+	return 0;
+}
+#define usleep sim_usleep
+
+// Virtual time source, only read by the display loop.
+static void clock_now(struct timeval *tv)
+{
+	sim.looping = 1;
+	tv->tv_sec = sim.now_us / 1000000;
+	tv->tv_usec = sim.now_us % 1000000;
+}
+
+static int sim_parse_time(const char *s, int64_t *us)
+{
+	struct tm tm;
+
+	memset(&tm, 0, sizeof(tm));
+	if (strptime(s, "%Y-%m-%d %H:%M:%S", &tm) == NULL) {
+	    return -1;
+	}
+	*us = (int64_t)timegm(&tm) * 1000000;
+	return 0;
+}
+
+// Read the timeline file.
+static int sim_load_timeline(const char *path)
+{
+	FILE *f;
+	char line[256];
+	int lineno = 0;
+	int rc = 0;
+
+	if ((f = fopen(path, "r")) == NULL) {
+	    fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+	    return -1;
+	}
+	sim.inside = 21;
+	sim.outside = -5;
+
+	while (rc == 0 && fgets(line, sizeof(line), f) != NULL) {
+	    char cmd[16], date[16], hms[16], arg[128];
+	    struct sim_step *step;
+	    struct sim_mode *mode;
+	    struct sim_display display;
+	    int n;
+
+	    lineno++;
+	    line[strcspn(line, "#\n")] = 0;
+	    n = sscanf(line, "%15s %127s", cmd, arg);
+	    if (n <= 0) {
+		continue;
+	    }
+
+	    if (strcmp(cmd, "tz") == 0 && n == 2) {
+		setenv("TZ", arg, 1);
+	    } else if (strcmp(cmd, "start") == 0 || strcmp(cmd, "end") == 0) {
+		int64_t *us = cmd[0] == 's' ? &sim.now_us : &sim.end_us;
+
+		if (sscanf(line, "%*s %15s %15s", date, hms) != 2) {
+		    rc = -1;
+		} else {
+		    snprintf(arg, sizeof(arg), "%s %s", date, hms);
+		    rc = sim_parse_time(arg, us);
+		}
+	    } else if (strcmp(cmd, "step") == 0) {
+		if (sim.nsteps == SIM_MAX_STEPS) {
+		    fprintf(stderr, "%s:%d: too many steps, at most %d\n", path, lineno, SIM_MAX_STEPS);
+		    rc = -1;
+		    break;
+		}
+		step = &sim.steps[sim.nsteps];
+		if (sscanf(line, "%*s %15s %15s %" SCNd64, date, hms, &step->delta) != 3) {
+		    rc = -1;
+		} else {
+		    snprintf(arg, sizeof(arg), "%s %s", date, hms);
+		    rc = sim_parse_time(arg, &step->at_us);
+		}
+		if (rc == 0 && sim.nsteps > 0 && step->at_us < step[-1].at_us) {
+		    fprintf(stderr, "%s:%d: steps must be in time order\n", path, lineno);
+		    rc = -1;
+		    break;
+		}
+		if (rc == 0) {
+		    sim.nsteps++;
+		}
+	    } else if (strcmp(cmd, "mode") == 0) {
+		if (sim.nmodes == SIM_MAX_MODES) {
+		    fprintf(stderr, "%s:%d: too many modes, at most %d\n", path, lineno, SIM_MAX_MODES);
+		    rc = -1;
+		    break;
+		}
+		mode = &sim.modes[sim.nmodes];
+		if (sscanf(line, "%*s %15s %15s %31[^\n]", date, hms, mode->cmd) != 3 ||
+		    sim_set_mode(&display, mode->cmd) != 0) {
+		    rc = -1;
+		} else {
+		    snprintf(arg, sizeof(arg), "%s %s", date, hms);
+		    rc = sim_parse_time(arg, &mode->at_us);
+		}
+		if (rc == 0 && sim.nmodes > 0 && mode->at_us < mode[-1].at_us) {
+		    fprintf(stderr, "%s:%d: modes must be in time order\n", path, lineno);
+		    rc = -1;
+		    break;
+		}
+		if (rc == 0) {
+		    sim.nmodes++;
+		}
+	    } else if (strcmp(cmd, "thermometers") == 0) {
+		if (sscanf(line, "%*s %d %d", &sim.inside, &sim.outside) != 2 ||
+		    sim.inside < 0 || sim.inside > 99 || abs(sim.outside) > 99) {
+		    rc = -1;
+		}
+	    } else {
+		rc = -1;
+	    }
+	    if (rc != 0) {
+		fprintf(stderr, "%s:%d: bad timeline command\n", path, lineno);
+	    }
+	}
+	fclose(f);
+
+	if (rc == 0 && sim.end_us <= sim.now_us) {
+	    fprintf(stderr, "%s: end must be after start\n", path);
+	    rc = -1;
+	}
+	tzset();
+
+	sim.start_us = sim.now_us;
+	sim.second = sim.now_us / 1000000;
+	clock_gettime(CLOCK_MONOTONIC, &sim.wall_start);
+
+	return rc;
+}
+
+// Parse the command line and read the timeline.
+static int sim_init(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "c")) != -1) {
+	    if (c == 'c') {
+		sim.check = 1;
+	    } else {
+		optind = argc + 1;
+		break;
+	    }
+	}
+	if (optind != argc - 1) {
+	    fprintf(stderr, "Usage: clock-sim [-c] <timeline>\n");
+	    return -1;
+	}
+	return sim_load_timeline(argv[optind]);
+}
+
+// Exit status of the simulation.
+static int sim_status(void)
+{
+	return sim.check && sim.mismatches > 0 ? 1 : 0;
+}
+
+static void wiringPiSetup(void)
+{
+}
+
+static void pinMode(int pin, int mode)
+{
+	(void)(pin);
+	(void)(mode);
+}
+
+static void digitalWrite(int pin, int value)
+{
+	sim.pins[pin] = value != LOW;
+}
+
+static ws2811_return_t ws2811_init(ws2811_t *ws2811)
+{
+	int i;
+
+	for (i = 0; i < RPI_PWM_CHANNELS; i++) {
+	    ws2811_channel_t *channel = &ws2811->channel[i];
+
+	    channel->leds = calloc(channel->count ? channel->count : 1, sizeof(ws2811_led_t));
+	    if (channel->leds == NULL) {
+		return WS2811_ERROR_OUT_OF_MEMORY;
+	    }
+	}
+	return WS2811_SUCCESS;
+}
+
+static ws2811_return_t ws2811_render(ws2811_t *ws2811)
+{
+	(void)(ws2811);
+	return WS2811_SUCCESS;
+}
+
+static void ws2811_fini(ws2811_t *ws2811)
+{
+	int i;
+
+	for (i = 0; i < RPI_PWM_CHANNELS; i++) {
+	    free(ws2811->channel[i].leds);
+	    ws2811->channel[i].leds = NULL;
+	}
+}
+
+static const char *ws2811_get_return_t_str(const ws2811_return_t state)
+{
+	return state == WS2811_SUCCESS ? "Success" : "Out of memory";
+}
+
+#endif // SIM_H